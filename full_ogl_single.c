@@ -1,11 +1,18 @@
+#ifndef HEADLESS
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#endif
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
+#include <sys/resource.h>
 
+#include "long_range.h"
+#include "mem.h"
+#include "particle.h"
+#include "splat.h"
 #include "tpool.h"
 
 #define NUM_THREADS 8
@@ -16,24 +23,43 @@
 #define WIDTH 1600
 #define HEIGHT 900
 
-#define BIN_SIZE 0.04
-#define GRID_WIDTH 512*2
-#define GRID_HEIGHT 512*2
-// #define MAX_PARTICLES_PER_BIN 256
+// frames to simulate when built with -DHEADLESS (no window to close), override with -DHEADLESS_FRAMES=n
+#ifndef HEADLESS_FRAMES
+#define HEADLESS_FRAMES 600
+#endif
+
+// software density render every SPLAT_INTERVAL frames, 0 disables, override with -DSPLAT_INTERVAL=n
+#ifndef SPLAT_INTERVAL
+#ifdef HEADLESS
+#define SPLAT_INTERVAL 10
+#else
+#define SPLAT_INTERVAL 0
+#endif
+#endif
+#define SPLAT_WIDTH (WIDTH / 2)
+#define SPLAT_HEIGHT (HEIGHT / 2)
+#define SPLAT_EXPOSURE 0.25f
+#define SPLAT_SPEED_SCALE 0.002f
+#define SPLAT_PATH "splat_%05d.ppm"
+
+// 1: permute particles into bin order in place, 0: scatter into back_particles.
+// Off by default: only ~1% of particles change bin per frame (SPEED vs BIN_SIZE), but at
+// ~1 particle per bin any count change shifts the range of every later bin, so nearly
+// every particle still lands outside its bin's range and has to be moved.
+#define IN_PLACE_BINNING 0
+// coarse row bands used to split the in-place permutation across threads
+#define NUM_BANDS (NUM_THREADS * 8)
+#define ROWS_PER_BAND ((GRID_HEIGHT) / NUM_BANDS)
+
+// 1: add tree-code self gravity on top of the short-range binned pass
+#define LONG_RANGE_FORCES 0
+#define LONG_RANGE_THETA 0.5f
+#define LONG_RANGE_G 0.00000002f
+#define LONG_RANGE_SOFTENING BIN_SIZE
+#define LONG_RANGE_QUADRUPOLE 0
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
-typedef struct {
-    float position[2];
-    float velocity[2];
-} Particle;
-
-typedef struct {
-    uint32_t offset;
-    uint16_t total_count;
-    uint16_t cur_count;
-} Bin;
-
 typedef struct {
     int start_bx;
     int end_bx;
@@ -43,6 +69,22 @@ typedef struct {
     Particle *particles;
 } ThreadData;
 
+// PARADIS-style bookkeeping for the parallel in-place band partition.
+// Band b still has unplaced particles in [band_head[b], band_tail[b]),
+// which each round splits into one stripe per thread.
+typedef struct {
+    Particle *particles;
+    uint32_t band_head[NUM_BANDS];
+    uint32_t band_tail[NUM_BANDS];
+    uint32_t stripe_head[NUM_THREADS][NUM_BANDS];
+    uint32_t stripe_tail[NUM_THREADS][NUM_BANDS];
+} BandPartition;
+
+typedef struct {
+    BandPartition *partition;
+    int idx; // thread index when permuting, band index when repairing
+} BandWork;
+
 float random_float() {
     return (float)rand() / RAND_MAX * 2.0f - 1.0f;
 }
@@ -149,12 +191,12 @@ void update_particles_binned_thread(void *arg) {
 }
 
 // Main function to manage pthreads
-void update_elementwise_par(tpool_t *tm, Bin *bins, Particle *particles) {
+void update_elementwise_par(tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles) {
 
     int num_work_items = NUM_THREADS * 8;
     int rows_per_work_item = NUM_PARTICLES / num_work_items;
 
-    ThreadData *thread_data = calloc(num_work_items, sizeof(ThreadData));
+    ThreadData *thread_data = arena_calloc(arena, num_work_items, sizeof(ThreadData));
     for (int i = 0; i < num_work_items; i++) {
         thread_data[i].start_bx = rows_per_work_item * i;
         thread_data[i].end_bx = rows_per_work_item * (i + 1);
@@ -164,19 +206,17 @@ void update_elementwise_par(tpool_t *tm, Bin *bins, Particle *particles) {
     }
 
     tpool_wait(tm);
-
-    free(thread_data);
 }
 
 // Main function to manage pthreads
-void update_particles_binned(tpool_t *tm, Bin *bins, Particle *particles) {
+void update_particles_binned(tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles) {
 
     int num_work_items = NUM_THREADS * 8;
     int sqrt_work_items = 8; // hardcoded for now!!
     int rows_per_work_item = GRID_HEIGHT / sqrt_work_items;//num_work_items;
     int cols_per_work_item = GRID_WIDTH / sqrt_work_items;//num_work_items;
 
-    ThreadData *thread_data = calloc(num_work_items, sizeof(ThreadData));
+    ThreadData *thread_data = arena_calloc(arena, num_work_items, sizeof(ThreadData));
     for (int i = 0; i < num_work_items; i++) {
         int j = i / sqrt_work_items;
         thread_data[i].start_bx = cols_per_work_item * (i % sqrt_work_items);
@@ -189,13 +229,6 @@ void update_particles_binned(tpool_t *tm, Bin *bins, Particle *particles) {
     }
 
     tpool_wait(tm);
-
-    free(thread_data);
-}
-
-uint32_t position_to_bin_idx(float x, float y) {
-    return ((uint32_t) (x / BIN_SIZE + 0.5 * GRID_WIDTH)) + 
-           ((uint32_t) (y / BIN_SIZE + 0.5 * GRID_HEIGHT)) * GRID_WIDTH;
 }
 
 void clear_bins(Bin *bins) {
@@ -231,11 +264,176 @@ void sort_into_bins(Bin *bins, Particle *particle_src, Particle *particle_dst) {
     }
 }
 
+uint32_t particle_band(Particle *p) {
+    uint32_t band = position_to_bin_idx(p->position[0], p->position[1]) / (ROWS_PER_BAND * GRID_WIDTH);
+    return band < NUM_BANDS ? band : NUM_BANDS - 1;
+}
+
+// Speculatively move particles into their bands, touching only this thread's stripes.
+// Particles that find no free slot in their target stripe are left behind for repair.
+void permute_bands_thread(void *arg) {
+    BandWork *work = (BandWork *)arg;
+    Particle *particles = work->partition->particles;
+    uint32_t *ph = work->partition->stripe_head[work->idx];
+    uint32_t *pt = work->partition->stripe_tail[work->idx];
+    for (uint32_t b = 0; b < NUM_BANDS; b++) {
+        uint32_t head = ph[b];
+        while (head < pt[b]) {
+            Particle v = particles[head];
+            uint32_t k = particle_band(&v);
+            if (k == b && head == ph[b]) {
+                // already in place, the common case when particles barely move
+                head++;
+                ph[b]++;
+                continue;
+            }
+            while (k != b && ph[k] < pt[k]) {
+                Particle tmp = particles[ph[k]];
+                particles[ph[k]++] = v;
+                v = tmp;
+                k = particle_band(&v);
+            }
+            if (k == b) {
+                particles[head++] = particles[ph[b]];
+                particles[ph[b]++] = v;
+            } else {
+                particles[head++] = v;
+            }
+        }
+    }
+}
+
+// Compact one band so its misplaced particles end up in a contiguous tail,
+// which becomes the unplaced range for the next round.
+void repair_band(void *arg) {
+    BandWork *work = (BandWork *)arg;
+    BandPartition *part = work->partition;
+    Particle *particles = part->particles;
+    uint32_t b = work->idx;
+    uint32_t tail = part->band_tail[b];
+    for (int t = 0; t < NUM_THREADS && part->stripe_head[t][b] < tail; t++) {
+        for (uint32_t head = part->stripe_head[t][b]; head < part->stripe_tail[t][b] && head < tail; head++) {
+            Particle v = particles[head];
+            if (particle_band(&v) == b) {
+                continue;
+            }
+            while (tail > head + 1 && particle_band(particles + tail - 1) != b) {
+                tail--;
+            }
+            if (tail <= head + 1) {
+                tail = head;
+                break;
+            }
+            tail--;
+            particles[head] = particles[tail];
+            particles[tail] = v;
+        }
+    }
+    part->band_head[b] = tail;
+}
+
+// Cycle-leader permutation of the bins inside one band. Particles already inside their
+// bin's range never move; cur_count marks the prefix of a bin known to hold its own particles.
+void sort_band_in_place_thread(void *arg) {
+    ThreadData *data = (ThreadData *)arg;
+    Bin *bins = data->bins;
+    Particle *particles = data->particles;
+    uint32_t first = bins[data->start_by * GRID_WIDTH].offset;
+    uint32_t last = data->end_by < GRID_HEIGHT ? bins[data->end_by * GRID_WIDTH].offset : NUM_PARTICLES;
+    for (uint32_t slot = first; slot < last; slot++) {
+        Particle p = particles[slot];
+        uint32_t d = position_to_bin_idx(p.position[0], p.position[1]);
+        if (slot - bins[d].offset < bins[d].total_count) {
+            continue;
+        }
+        do {
+            // bin d must still hold a foreign particle, find it and swap p in
+            uint32_t dst_idx = bins[d].offset + bins[d].cur_count;
+            uint32_t dst_bin;
+            while ((dst_bin = position_to_bin_idx(particles[dst_idx].position[0], particles[dst_idx].position[1])) == d) {
+                dst_idx++;
+            }
+            bins[d].cur_count = dst_idx - bins[d].offset + 1;
+            Particle tmp = particles[dst_idx];
+            particles[dst_idx] = p;
+            p = tmp;
+            d = dst_bin;
+        } while (slot - bins[d].offset >= bins[d].total_count);
+        particles[slot] = p;
+    }
+}
+
+// Reorder particles into bin order without a second particle buffer.
+// First partition into row bands in parallel, then sort each band independently.
+void sort_into_bins_in_place(tpool_t *tm, Bin *bins, Particle *particles) {
+    BandPartition part;
+    BandWork work[max(NUM_THREADS, NUM_BANDS)];
+    part.particles = particles;
+    for (int b = 0; b < NUM_BANDS; b++) {
+        part.band_head[b] = bins[b * ROWS_PER_BAND * GRID_WIDTH].offset;
+        part.band_tail[b] = b + 1 < NUM_BANDS ? bins[(b + 1) * ROWS_PER_BAND * GRID_WIDTH].offset : NUM_PARTICLES;
+    }
+
+    while (1) {
+        int done = 1;
+        for (int b = 0; b < NUM_BANDS; b++) {
+            uint64_t remaining = part.band_tail[b] - part.band_head[b];
+            done &= remaining == 0;
+            for (int t = 0; t < NUM_THREADS; t++) {
+                part.stripe_head[t][b] = part.band_head[b] + remaining * t / NUM_THREADS;
+                part.stripe_tail[t][b] = part.band_head[b] + remaining * (t + 1) / NUM_THREADS;
+            }
+        }
+        if (done) {
+            break;
+        }
+
+        for (int t = 0; t < NUM_THREADS; t++) {
+            work[t] = (BandWork) { &part, t };
+            tpool_add_work(tm, permute_bands_thread, work + t);
+        }
+        tpool_wait(tm);
+
+        for (int b = 0; b < NUM_BANDS; b++) {
+            work[b] = (BandWork) { &part, b };
+            tpool_add_work(tm, repair_band, work + b);
+        }
+        tpool_wait(tm);
+    }
+
+    ThreadData thread_data[NUM_BANDS];
+    for (int b = 0; b < NUM_BANDS; b++) {
+        thread_data[b].start_by = b * ROWS_PER_BAND;
+        thread_data[b].end_by = b + 1 < NUM_BANDS ? (b + 1) * ROWS_PER_BAND : GRID_HEIGHT;
+        thread_data[b].bins = bins;
+        thread_data[b].particles = particles;
+        tpool_add_work(tm, sort_band_in_place_thread, thread_data + b);
+    }
+    tpool_wait(tm);
+}
+
 double calculate_elapsed_time(struct timespec start, struct timespec end) {
     return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 }
 
+double wall_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+}
+
 int main() {
+#ifndef HEADLESS
     if (!glfwInit()) {
         fprintf(stderr, "Failed to initialize GLFW\n");
         return -1;
@@ -257,13 +455,22 @@ int main() {
         fprintf(stderr, "Failed to initialize GLEW\n");
         return -1;
     }
+#endif
 
     printf("initializing with %d particles\n", NUM_PARTICLES);
 
-    Particle *particles = calloc(NUM_PARTICLES, sizeof(Particle));
-    Particle *back_particles = calloc(NUM_PARTICLES, sizeof(Particle));
+    Particle *particles = mem_alloc_huge(NUM_PARTICLES * sizeof(Particle));
+#if IN_PLACE_BINNING
+    Particle *back_particles = NULL;
+#else
+    Particle *back_particles = mem_alloc_huge(NUM_PARTICLES * sizeof(Particle));
+#endif
+
+    Bin *bins = mem_alloc_huge(GRID_WIDTH * GRID_HEIGHT * sizeof(Bin));
 
-    Bin *bins = calloc(GRID_WIDTH * GRID_HEIGHT, sizeof(Bin));
+    // per-frame scratch (work item arrays), reset at the top of every frame
+    arena_t frame_arena;
+    arena_init(&frame_arena, HUGE_PAGE_SIZE);
 
     float size_sq = sqrt((float) NUM_PARTICLES);
     int size_sq_i = (int) size_sq;
@@ -274,20 +481,25 @@ int main() {
         particles[i].velocity[1] = random_float() * SPEED;
     }
 
+    float ratio = (float) WIDTH / (float) HEIGHT;
+    float view_scale[2] = { 0.6 * 0.2, 0.6 * 0.2 * ratio };
+
+#ifndef HEADLESS
     GLuint vao, vbo;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, NUM_PARTICLES * 2 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, NUM_PARTICLES * sizeof(Particle), NULL, GL_DYNAMIC_DRAW);
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+    // read positions straight out of the particle structs, skipping the velocity
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)0);
     glEnableVertexAttribArray(0);
 
     // Load and compile shaders
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    const char *vertexSource = "#version 330 core\nlayout(location = 0) in vec2 position;\nvoid main() { gl_PointSize = 1.0; gl_Position = vec4(0.6*position, 0.0, 1.0); }";
+    const char *vertexSource = "#version 330 core\nlayout(location = 0) in vec2 position;\nuniform vec2 scale;\nvoid main() { gl_PointSize = 1.0; gl_Position = vec4(scale*position, 0.0, 1.0); }";
     glShaderSource(vertexShader, 1, &vertexSource, NULL);
     glCompileShader(vertexShader);
 
@@ -308,17 +520,35 @@ int main() {
 
     glEnable(GL_PROGRAM_POINT_SIZE); 
 
-    float *particle_pos_data = calloc(NUM_PARTICLES, sizeof(float) * 2);
+    glUniform2f(glGetUniformLocation(shaderProgram, "scale"), view_scale[0], view_scale[1]);
+#endif
+
+#if SPLAT_INTERVAL
+    splat_t *splat = splat_create(SPLAT_WIDTH, SPLAT_HEIGHT, view_scale, SPLAT_EXPOSURE, SPLAT_SPEED_SCALE, SPLAT_PATH);
+#endif
     
     struct timespec start, end;
     double clear_bins_time = 0, update_bins_time = 0, swap_time = 0, sort_bins_time = 0;
-    double update_binned_time = 0, update_elementwise_time = 0, render_time = 0;
+    double update_binned_time = 0, long_range_time = 0, update_elementwise_time = 0, render_time = 0;
     int frame_count = 0;
-    double sim_start_time = glfwGetTime();
+    int frame_idx = 0;
+    double sim_start_time = wall_time();
 
     tpool_t *tm   = tpool_create(NUM_THREADS);
-
+#if LONG_RANGE_FORCES
+    long_range_t *lr = long_range_create(LONG_RANGE_THETA, LONG_RANGE_G, LONG_RANGE_SOFTENING, LONG_RANGE_QUADRUPOLE);
+#endif
+    bool tlb_counting = tlb_counters_open();
+    uint64_t tlb_misses_start = tlb_counters_read();
+    size_t arena_allocs_start = 0;
+
+#ifdef HEADLESS
+    while (frame_idx < HEADLESS_FRAMES) {
+#else
     while (!glfwWindowShouldClose(window)) {
+#endif
+        arena_reset(&frame_arena);
+
         clock_gettime(CLOCK_MONOTONIC, &start);
         clear_bins(bins);
         // Clear bins timing
@@ -331,6 +561,13 @@ int main() {
         clock_gettime(CLOCK_MONOTONIC, &end);
         update_bins_time += calculate_elapsed_time(start, end);
 
+#if IN_PLACE_BINNING
+        // Sort into bins timing
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sort_into_bins_in_place(tm, bins, particles);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sort_bins_time += calculate_elapsed_time(start, end);
+#else
         // Swap particles timing
         clock_gettime(CLOCK_MONOTONIC, &start);
         Particle *temp = particles;
@@ -344,72 +581,123 @@ int main() {
         sort_into_bins(bins, back_particles, particles);
         clock_gettime(CLOCK_MONOTONIC, &end);
         sort_bins_time += calculate_elapsed_time(start, end);
+#endif
 
         // Update particles (binned) timing
         clock_gettime(CLOCK_MONOTONIC, &start);
-        update_particles_binned(tm, bins, particles);
+        update_particles_binned(tm, &frame_arena, bins, particles);
         clock_gettime(CLOCK_MONOTONIC, &end);
         update_binned_time += calculate_elapsed_time(start, end);
 
+#if LONG_RANGE_FORCES
+        // Long-range forces timing
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        long_range_build(lr, tm, &frame_arena, bins, particles);
+        long_range_apply(lr, tm, &frame_arena, bins, particles);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long_range_time += calculate_elapsed_time(start, end);
+#endif
+
         // Update particles (element-wise) timing
         clock_gettime(CLOCK_MONOTONIC, &start);
-        update_elementwise_par(tm, bins, particles);
+        update_elementwise_par(tm, &frame_arena, bins, particles);
         clock_gettime(CLOCK_MONOTONIC, &end);
         update_elementwise_time += calculate_elapsed_time(start, end);
 
         // Render timing
         clock_gettime(CLOCK_MONOTONIC, &start);
 
-        float ratio = (float) WIDTH / (float) HEIGHT;
-        for (int i = 0; i < NUM_PARTICLES; i++) {
-            particle_pos_data[i * 2 + 0] = 0.2 * particles[i].position[0];
-            particle_pos_data[i * 2 + 1] = 0.2 * particles[i].position[1] * ratio;
+#if SPLAT_INTERVAL
+        if (frame_idx % SPLAT_INTERVAL == 0) {
+            splat_frame(splat, tm, &frame_arena, bins, particles, frame_idx);
         }
+#endif
 
+#ifndef HEADLESS
         glClear(GL_COLOR_BUFFER_BIT);
 
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, NUM_PARTICLES * 2 * sizeof(float), particle_pos_data, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, NUM_PARTICLES * sizeof(Particle), particles, GL_DYNAMIC_DRAW);
 
         glBindVertexArray(vao);
         glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+#endif
 
         clock_gettime(CLOCK_MONOTONIC, &end);
         render_time += calculate_elapsed_time(start, end);
 
         frame_count++;
-        if (glfwGetTime() - sim_start_time >= 1.0) {
+        frame_idx++;
+        if (wall_time() - sim_start_time >= 1.0) {
             printf("Average times per stage (seconds):\n");
             printf("Clear Bins: %f ms\n", 1000.0 * clear_bins_time / frame_count);
             printf("Update Bins: %f ms\n", 1000.0 * update_bins_time / frame_count);
             printf("Swap Particles: %f ms\n", 1000.0 * swap_time / frame_count);
             printf("Sort Into Bins: %f ms\n", 1000.0 * sort_bins_time / frame_count);
             printf("Update Particles (Binned): %f ms\n", 1000.0 * update_binned_time / frame_count);
+            printf("Long Range Forces: %f ms\n", 1000.0 * long_range_time / frame_count);
             printf("Update Particles (Element-wise): %f ms\n", 1000.0 * update_elementwise_time / frame_count);
-            printf("total sim time: %f ms\n", 1000.0 * (clear_bins_time + swap_time + 
-                sort_bins_time + update_bins_time + update_binned_time + update_elementwise_time) / frame_count);
+            printf("total sim time: %f ms\n", 1000.0 * (clear_bins_time + swap_time + sort_bins_time +
+                update_bins_time + update_binned_time + long_range_time + update_elementwise_time) / frame_count);
             printf("Render: %f ms\n", 1000.0 * render_time / frame_count);
+            printf("Peak RSS: %.1f MB\n", peak_rss_mb());
+
+            mem_stats_t mem_stats;
+            mem_get_stats(&mem_stats);
+            printf("Huge page arrays: %zu allocs, hugetlb %.1f MB, THP %.1f MB (%.1f MB resident), 4K %.1f MB\n",
+                mem_stats.alloc_cnt, mem_stats.hugetlb_bytes / 1048576.0, mem_stats.thp_bytes / 1048576.0,
+                mem_thp_resident_bytes() / 1048576.0, mem_stats.small_bytes / 1048576.0);
+            printf("Frame arena: %.1f allocs/frame, high water %zu bytes, thread pool work items: %zu\n",
+                (double) (frame_arena.alloc_cnt - arena_allocs_start) / frame_count, frame_arena.high_water,
+                tm->work_alloc_cnt);
+            if (tlb_counting) {
+                uint64_t tlb_misses = tlb_counters_read();
+                printf("dTLB load misses: %.0f per frame\n", (double) (tlb_misses - tlb_misses_start) / frame_count);
+                tlb_misses_start = tlb_misses;
+            } else {
+                printf("dTLB load misses: unavailable\n");
+            }
+            arena_allocs_start = frame_arena.alloc_cnt;
+#if SPLAT_INTERVAL
+            size_t splat_written, splat_dropped;
+            splat_get_counts(splat, &splat_written, &splat_dropped);
+            printf("Splat images: %zu written, %zu dropped while the writer was busy\n",
+                splat_written, splat_dropped);
+#endif
             printf("-----------------------------\n");
 
             // Reset counters
-            clear_bins_time = update_bins_time = swap_time = sort_bins_time = update_binned_time = update_elementwise_time = render_time = 0;
+            clear_bins_time = update_bins_time = swap_time = sort_bins_time = update_binned_time = long_range_time = 0;
+            update_elementwise_time = render_time = 0;
             frame_count = 0;
-            sim_start_time = glfwGetTime();
+            sim_start_time = wall_time();
         }
     }
 
+#if SPLAT_INTERVAL
+    splat_destroy(splat);
+#endif
+#ifndef HEADLESS
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
     glDeleteProgram(shaderProgram);
-    free(particles);
-    free(bins);
-    free(back_particles);
+#endif
+    mem_free_huge(particles, NUM_PARTICLES * sizeof(Particle));
+    mem_free_huge(bins, GRID_WIDTH * GRID_HEIGHT * sizeof(Bin));
+    mem_free_huge(back_particles, NUM_PARTICLES * sizeof(Particle));
+    arena_destroy(&frame_arena);
+#if LONG_RANGE_FORCES
+    long_range_destroy(lr);
+#endif
+    tlb_counters_close();
     tpool_destroy(tm);
+#ifndef HEADLESS
     glfwTerminate();
+#endif
 
     return 0;
 }
@@ -0,0 +1,330 @@
+#include "long_range.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (GRID_WIDTH) != (GRID_HEIGHT) || ((GRID_WIDTH) & ((GRID_WIDTH) - 1)) != 0
+#error "long range pyramid needs a square, power of two bin grid"
+#endif
+
+// targets are walked in groups of 4x4 bins, at most LONG_RANGE_CHUNK particles per walk
+#define LONG_RANGE_GROUP_LEVEL 2
+#define LONG_RANGE_CHUNK 256
+
+typedef struct {
+    long_range_t *lr;
+    int           level;
+    int           start_row;
+    int           end_row;
+    Bin          *bins;
+    Particle     *particles;
+} long_range_work_t;
+
+typedef struct {
+    int level;
+    int x;
+    int y;
+} node_ref_t;
+
+static int level_dim(int level)
+{
+    return GRID_WIDTH >> level;
+}
+
+long_range_t *long_range_create(float theta, float g, float softening, bool quadrupole)
+{
+    long_range_t *lr;
+    moment_t     *storage;
+    size_t        offset = 0;
+
+    lr             = calloc(1, sizeof(*lr));
+    lr->theta      = theta;
+    lr->g          = g;
+    lr->softening  = softening;
+    lr->quadrupole = quadrupole;
+
+    while (level_dim(lr->num_levels) > 0) {
+        lr->num_cells += (size_t)level_dim(lr->num_levels) * level_dim(lr->num_levels);
+        lr->num_levels++;
+    }
+
+    storage = mem_alloc_huge(lr->num_cells * sizeof(moment_t));
+    if (storage == NULL) {
+        free(lr);
+        return NULL;
+    }
+    for (int level = 0; level < lr->num_levels; level++) {
+        lr->levels[level] = storage + offset;
+        offset += (size_t)level_dim(level) * level_dim(level);
+    }
+    return lr;
+}
+
+void long_range_destroy(long_range_t *lr)
+{
+    if (lr == NULL)
+        return;
+    mem_free_huge(lr->levels[0], lr->num_cells * sizeof(moment_t));
+    free(lr);
+}
+
+static void long_range_dispatch(long_range_t *lr, tpool_t *tm, arena_t *arena, thread_func_t func,
+                                int level, Bin *bins, Particle *particles)
+{
+    int rows = level_dim(level);
+    int num_work_items = (int)tm->thread_cnt * 8;
+    long_range_work_t *work;
+
+    if (num_work_items > rows)
+        num_work_items = rows;
+
+    work = arena_calloc(arena, num_work_items, sizeof(*work));
+    for (int i = 0; i < num_work_items; i++) {
+        work[i].lr        = lr;
+        work[i].level     = level;
+        work[i].start_row = rows * i / num_work_items;
+        work[i].end_row   = rows * (i + 1) / num_work_items;
+        work[i].bins      = bins;
+        work[i].particles = particles;
+        tpool_add_work(tm, func, work + i);
+    }
+    tpool_wait(tm);
+}
+
+static void build_leaf_rows(void *arg)
+{
+    long_range_work_t *work = arg;
+    moment_t *moments = work->lr->levels[0];
+
+    for (int by = work->start_row; by < work->end_row; by++) {
+        for (int bx = 0; bx < GRID_WIDTH; bx++) {
+            Bin       bin = work->bins[bx + by * GRID_WIDTH];
+            Particle *p   = work->particles + bin.offset;
+            moment_t  m   = { 0 };
+
+            if (bin.total_count > 0) {
+                for (int i = 0; i < bin.total_count; i++) {
+                    m.com[0] += p[i].position[0];
+                    m.com[1] += p[i].position[1];
+                }
+                m.mass    = bin.total_count;
+                m.com[0] /= m.mass;
+                m.com[1] /= m.mass;
+                if (work->lr->quadrupole) {
+                    for (int i = 0; i < bin.total_count; i++) {
+                        float dx = p[i].position[0] - m.com[0];
+                        float dy = p[i].position[1] - m.com[1];
+                        m.quad[0] += 2.0f * dx * dx - dy * dy;
+                        m.quad[1] += 3.0f * dx * dy;
+                        m.quad[2] += 2.0f * dy * dy - dx * dx;
+                    }
+                }
+            }
+            moments[bx + by * GRID_WIDTH] = m;
+        }
+    }
+}
+
+static void build_parent_rows(void *arg)
+{
+    long_range_work_t *work = arg;
+    int       dim      = level_dim(work->level);
+    moment_t *moments  = work->lr->levels[work->level];
+    moment_t *children = work->lr->levels[work->level - 1];
+
+    for (int y = work->start_row; y < work->end_row; y++) {
+        for (int x = 0; x < dim; x++) {
+            moment_t *c[4] = {
+                children + (2 * x)     + (2 * y)     * (2 * dim),
+                children + (2 * x + 1) + (2 * y)     * (2 * dim),
+                children + (2 * x)     + (2 * y + 1) * (2 * dim),
+                children + (2 * x + 1) + (2 * y + 1) * (2 * dim),
+            };
+            moment_t m = { 0 };
+
+            for (int i = 0; i < 4; i++) {
+                m.mass   += c[i]->mass;
+                m.com[0] += c[i]->mass * c[i]->com[0];
+                m.com[1] += c[i]->mass * c[i]->com[1];
+            }
+            if (m.mass > 0.0f) {
+                m.com[0] /= m.mass;
+                m.com[1] /= m.mass;
+            }
+            if (work->lr->quadrupole) {
+                // parallel axis shift of each child's quadrupole to the new center
+                for (int i = 0; i < 4; i++) {
+                    float sx = c[i]->com[0] - m.com[0];
+                    float sy = c[i]->com[1] - m.com[1];
+                    m.quad[0] += c[i]->quad[0] + c[i]->mass * (2.0f * sx * sx - sy * sy);
+                    m.quad[1] += c[i]->quad[1] + c[i]->mass * (3.0f * sx * sy);
+                    m.quad[2] += c[i]->quad[2] + c[i]->mass * (2.0f * sy * sy - sx * sx);
+                }
+            }
+            moments[x + y * dim] = m;
+        }
+    }
+}
+
+void long_range_build(long_range_t *lr, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles)
+{
+    long_range_dispatch(lr, tm, arena, build_leaf_rows, 0, bins, particles);
+    for (int level = 1; level < lr->num_levels; level++)
+        long_range_dispatch(lr, tm, arena, build_parent_rows, level, bins, particles);
+}
+
+// Softened acceleration at pos due to a node's multipole expansion
+static inline void accumulate_node(const long_range_t *lr, const moment_t *m, const float *pos, float *acc)
+{
+    float dx     = pos[0] - m->com[0];
+    float dy     = pos[1] - m->com[1];
+    float r2     = dx * dx + dy * dy + lr->softening * lr->softening;
+    float inv_r  = 1.0f / sqrtf(r2);
+    float inv_r3 = inv_r * inv_r * inv_r;
+
+    acc[0] -= m->mass * dx * inv_r3;
+    acc[1] -= m->mass * dy * inv_r3;
+
+    if (lr->quadrupole) {
+        float inv_r5 = inv_r3 * inv_r * inv_r;
+        float qx     = m->quad[0] * dx + m->quad[1] * dy;
+        float qy     = m->quad[1] * dx + m->quad[2] * dy;
+        float dqd    = dx * qx + dy * qy;
+        float radial = 2.5f * dqd * inv_r5 * inv_r * inv_r;
+
+        acc[0] += qx * inv_r5 - radial * dx;
+        acc[1] += qy * inv_r5 - radial * dy;
+    }
+}
+
+static inline void accumulate_particle(const long_range_t *lr, const Particle *src, const float *pos, float *acc)
+{
+    float dx     = pos[0] - src->position[0];
+    float dy     = pos[1] - src->position[1];
+    float r2     = dx * dx + dy * dy + lr->softening * lr->softening;
+    float inv_r  = 1.0f / sqrtf(r2);
+    float inv_r3 = inv_r * inv_r * inv_r;
+
+    // a particle's own contribution vanishes since dx = dy = 0
+    acc[0] -= dx * inv_r3;
+    acc[1] -= dy * inv_r3;
+}
+
+// Tree walk for up to LONG_RANGE_CHUNK particles of one target group. Nodes accepted for
+// the whole group are applied to each of its particles, leaves that are too close are summed directly.
+static void apply_group(long_range_work_t *work, const float *open_dist2, int gx, int gy,
+                        const uint32_t *targets, int count)
+{
+    long_range_t *lr = work->lr;
+    node_ref_t    stack[4 * LONG_RANGE_MAX_LEVELS];
+    float         acc[LONG_RANGE_CHUNK][2];
+    float         group_size = BIN_SIZE * (1 << LONG_RANGE_GROUP_LEVEL);
+    float         center[2]  = {
+        (gx + 0.5f) * group_size - 0.5f * GRID_WIDTH * BIN_SIZE,
+        (gy + 0.5f) * group_size - 0.5f * GRID_HEIGHT * BIN_SIZE,
+    };
+    int top = 0;
+
+    memset(acc, 0, count * sizeof(acc[0]));
+    stack[top++] = (node_ref_t) { lr->num_levels - 1, 0, 0 };
+    while (top > 0) {
+        node_ref_t      node = stack[--top];
+        const moment_t *m    = lr->levels[node.level] + node.x + node.y * level_dim(node.level);
+        bool            overlaps;
+        float           dx, dy;
+
+        if (m->mass == 0.0f)
+            continue;
+
+        // quadtree cells overlap only when one is an ancestor of the other
+        if (node.level >= LONG_RANGE_GROUP_LEVEL) {
+            int shift = node.level - LONG_RANGE_GROUP_LEVEL;
+            overlaps  = (gx >> shift) == node.x && (gy >> shift) == node.y;
+        } else {
+            int shift = LONG_RANGE_GROUP_LEVEL - node.level;
+            overlaps  = (node.x >> shift) == gx && (node.y >> shift) == gy;
+        }
+        dx = center[0] - m->com[0];
+        dy = center[1] - m->com[1];
+
+        if (!overlaps && dx * dx + dy * dy > open_dist2[node.level]) {
+            for (int i = 0; i < count; i++)
+                accumulate_node(lr, m, work->particles[targets[i]].position, acc[i]);
+        } else if (node.level == 0) {
+            Bin       src_bin = work->bins[node.x + node.y * GRID_WIDTH];
+            Particle *src     = work->particles + src_bin.offset;
+            for (int i = 0; i < count; i++) {
+                for (int j = 0; j < src_bin.total_count; j++)
+                    accumulate_particle(lr, src + j, work->particles[targets[i]].position, acc[i]);
+            }
+        } else {
+            for (int child = 0; child < 4; child++) {
+                stack[top++] = (node_ref_t) {
+                    node.level - 1, 2 * node.x + (child & 1), 2 * node.y + (child >> 1)
+                };
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        work->particles[targets[i]].velocity[0] += lr->g * acc[i][0];
+        work->particles[targets[i]].velocity[1] += lr->g * acc[i][1];
+    }
+}
+
+// Walks target groups of 2^LONG_RANGE_GROUP_LEVEL squared bins, so one walk is shared by
+// all particles in the group. Rows here are group rows.
+static void apply_rows(void *arg)
+{
+    long_range_work_t *work = arg;
+    int      group_bins = 1 << LONG_RANGE_GROUP_LEVEL;
+    float    half_diag  = 0.5f * sqrtf(2.0f) * BIN_SIZE * group_bins;
+    float    open_dist2[LONG_RANGE_MAX_LEVELS];
+    uint32_t targets[LONG_RANGE_CHUNK];
+
+    // accept a node once its center of mass is further than size / theta from every target
+    for (int level = 0; level < work->lr->num_levels; level++) {
+        float d = BIN_SIZE * (1 << level) / work->lr->theta + half_diag;
+        open_dist2[level] = d * d;
+    }
+
+    for (int gy = work->start_row; gy < work->end_row; gy++) {
+        for (int gx = 0; gx < level_dim(LONG_RANGE_GROUP_LEVEL); gx++) {
+            int count = 0;
+
+            // each bin row of the group is one contiguous particle range
+            for (int by = gy * group_bins; by < (gy + 1) * group_bins; by++) {
+                Bin     *row   = work->bins + gx * group_bins + by * GRID_WIDTH;
+                uint32_t first = row[0].offset;
+                uint32_t last  = row[group_bins - 1].offset + row[group_bins - 1].total_count;
+
+                for (uint32_t i = first; i < last; i++) {
+                    targets[count++] = i;
+                    if (count == LONG_RANGE_CHUNK) {
+                        apply_group(work, open_dist2, gx, gy, targets, count);
+                        count = 0;
+                    }
+                }
+            }
+            if (count > 0)
+                apply_group(work, open_dist2, gx, gy, targets, count);
+        }
+    }
+}
+
+void long_range_apply(long_range_t *lr, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles)
+{
+    long_range_dispatch(lr, tm, arena, apply_rows, LONG_RANGE_GROUP_LEVEL, bins, particles);
+}
+
+void long_range_direct(const long_range_t *lr, Particle *particles, size_t num)
+{
+    for (size_t i = 0; i < num; i++) {
+        float acc[2] = { 0.0f, 0.0f };
+        for (size_t j = 0; j < num; j++)
+            accumulate_particle(lr, particles + j, particles[i].position, acc);
+        particles[i].velocity[0] += lr->g * acc[0];
+        particles[i].velocity[1] += lr->g * acc[1];
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __LONG_RANGE_H__
+#define __LONG_RANGE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mem.h"
+#include "particle.h"
+#include "tpool.h"
+
+// Barnes-Hut style long-range attraction that reuses the bin grid as the
+// bottom of a mip pyramid of multipole moments. Requires particles sorted by bin.
+
+#define LONG_RANGE_MAX_LEVELS 32
+
+typedef struct {
+    float mass;
+    float com[2];
+    float quad[3]; // traceless quadrupole (xx, xy, yy) about com
+} moment_t;
+
+typedef struct {
+    float     theta;      // opening angle, smaller is more accurate and slower
+    float     g;          // coupling per pair of unit-mass particles
+    float     softening;
+    bool      quadrupole;
+    int       num_levels; // level 0 is the bin grid, each level above halves both dimensions
+    moment_t *levels[LONG_RANGE_MAX_LEVELS];
+    size_t    num_cells;
+} long_range_t;
+
+long_range_t *long_range_create(float theta, float g, float softening, bool quadrupole);
+void long_range_destroy(long_range_t *lr);
+
+// Rebuild the moment pyramid from the current bins
+void long_range_build(long_range_t *lr, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles);
+// Add the far-field (multipole) plus near-field (direct) acceleration to every velocity
+void long_range_apply(long_range_t *lr, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles);
+
+// O(N^2) reference with the same kernel, for accuracy checks on small N
+void long_range_direct(const long_range_t *lr, Particle *particles, size_t num);
+
+#endif /* __LONG_RANGE_H__ */
@@ -0,0 +1,131 @@
+// Accuracy and scaling of the long-range tree solver against direct summation.
+// Builds without OpenGL: make long_range_bench && ./long_range_bench
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "long_range.h"
+#include "mem.h"
+#include "particle.h"
+#include "tpool.h"
+
+#define NUM_THREADS 8
+#define MAX_PARTICLES (1 << 20)
+#define MAX_DIRECT_PARTICLES (1 << 14)
+#define SOFTENING 0.04f
+
+double calculate_elapsed_time(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Gaussian blob plus a uniform disc, so the tree sees both dense and sparse regions
+void generate_particles(Particle *particles, int num) {
+    for (int i = 0; i < num; i++) {
+        float u = ((float) rand() + 1.0f) / ((float) RAND_MAX + 1.0f);
+        float v = (float) rand() / RAND_MAX;
+        float r = i % 2 ? 3.0f * sqrtf(-2.0f * logf(u)) : 15.0f * sqrtf(u);
+        r = fminf(r, 19.0f);
+        particles[i].position[0] = r * cosf(6.2831853f * v);
+        particles[i].position[1] = r * sinf(6.2831853f * v);
+        particles[i].velocity[0] = 0.0f;
+        particles[i].velocity[1] = 0.0f;
+    }
+}
+
+void bin_particles(Bin *bins, Particle *src, Particle *dst, int num) {
+    memset(bins, 0, GRID_WIDTH * GRID_HEIGHT * sizeof(Bin));
+    for (int i = 0; i < num; i++) {
+        bins[position_to_bin_idx(src[i].position[0], src[i].position[1])].total_count += 1;
+    }
+    for (int i = 1; i < GRID_WIDTH * GRID_HEIGHT; i++) {
+        bins[i].offset = bins[i-1].total_count + bins[i-1].offset;
+    }
+    for (int i = 0; i < num; i++) {
+        Bin *bin = bins + position_to_bin_idx(src[i].position[0], src[i].position[1]);
+        dst[bin->offset + bin->cur_count++] = src[i];
+    }
+}
+
+// Tree time in ms, velocities of particles hold the resulting acceleration
+double run_tree(long_range_t *lr, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles, int num) {
+    struct timespec start, end;
+    for (int i = 0; i < num; i++) {
+        particles[i].velocity[0] = particles[i].velocity[1] = 0.0f;
+    }
+    arena_reset(arena);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long_range_build(lr, tm, arena, bins, particles);
+    long_range_apply(lr, tm, arena, bins, particles);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return 1000.0 * calculate_elapsed_time(start, end);
+}
+
+int main() {
+    Particle *unsorted = mem_alloc_huge(MAX_PARTICLES * sizeof(Particle));
+    Particle *particles = mem_alloc_huge(MAX_PARTICLES * sizeof(Particle));
+    Particle *reference = mem_alloc_huge(MAX_DIRECT_PARTICLES * sizeof(Particle));
+    Bin *bins = mem_alloc_huge(GRID_WIDTH * GRID_HEIGHT * sizeof(Bin));
+    tpool_t *tm = tpool_create(NUM_THREADS);
+    arena_t arena;
+    arena_init(&arena, HUGE_PAGE_SIZE);
+    struct timespec start, end;
+
+    srand(1234);
+
+    printf("accuracy vs direct summation (relative acceleration error)\n");
+    printf("%8s %6s %5s %12s %12s %12s %12s\n", "N", "theta", "quad", "rms err", "max err", "tree ms", "direct ms");
+    for (int num = 1 << 10; num <= MAX_DIRECT_PARTICLES; num <<= 2) {
+        generate_particles(unsorted, num);
+        bin_particles(bins, unsorted, particles, num);
+
+        long_range_t *lr = long_range_create(0.5f, 1.0f, SOFTENING, false);
+        memcpy(reference, particles, num * sizeof(Particle));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        long_range_direct(lr, reference, num);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double direct_ms = 1000.0 * calculate_elapsed_time(start, end);
+        long_range_destroy(lr);
+
+        float thetas[] = { 0.3f, 0.5f, 0.7f, 1.0f };
+        for (int t = 0; t < 4; t++) {
+            for (int quad = 0; quad <= 1; quad++) {
+                lr = long_range_create(thetas[t], 1.0f, SOFTENING, quad);
+                double tree_ms = run_tree(lr, tm, &arena, bins, particles, num);
+                double err_sq = 0.0, err_max = 0.0;
+                for (int i = 0; i < num; i++) {
+                    double ex = particles[i].velocity[0] - reference[i].velocity[0];
+                    double ey = particles[i].velocity[1] - reference[i].velocity[1];
+                    double mag = hypot(reference[i].velocity[0], reference[i].velocity[1]);
+                    double err = hypot(ex, ey) / fmax(mag, 1e-12);
+                    err_sq += err * err;
+                    err_max = fmax(err_max, err);
+                }
+                printf("%8d %6.2f %5d %12.2e %12.2e %12.2f %12.2f\n",
+                    num, thetas[t], quad, sqrt(err_sq / num), err_max, tree_ms, direct_ms);
+                long_range_destroy(lr);
+            }
+        }
+    }
+
+    printf("\nscaling (theta 0.5, monopole)\n");
+    printf("%8s %12s %12s\n", "N", "tree ms", "ns/particle");
+    long_range_t *lr = long_range_create(0.5f, 1.0f, SOFTENING, false);
+    for (int num = 1 << 12; num <= MAX_PARTICLES; num <<= 2) {
+        generate_particles(unsorted, num);
+        bin_particles(bins, unsorted, particles, num);
+        double tree_ms = run_tree(lr, tm, &arena, bins, particles, num);
+        printf("%8d %12.2f %12.1f\n", num, tree_ms, 1e6 * tree_ms / num);
+    }
+    long_range_destroy(lr);
+
+    arena_destroy(&arena);
+    tpool_destroy(tm);
+    mem_free_huge(unsorted, MAX_PARTICLES * sizeof(Particle));
+    mem_free_huge(particles, MAX_PARTICLES * sizeof(Particle));
+    mem_free_huge(reference, MAX_DIRECT_PARTICLES * sizeof(Particle));
+    mem_free_huge(bins, GRID_WIDTH * GRID_HEIGHT * sizeof(Bin));
+    return 0;
+}
@@ -0,0 +1,217 @@
+#define _GNU_SOURCE
+
+#include "mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define MEM_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define ARENA_ALIGN 64
+#define MAX_TLB_COUNTERS 64
+
+static mem_stats_t stats;
+
+static size_t round_up(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+bool arena_init(arena_t *arena, size_t capacity)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->base = mem_alloc_huge(capacity);
+    if (arena->base == NULL)
+        return false;
+    arena->capacity = round_up(capacity, HUGE_PAGE_SIZE);
+    return true;
+}
+
+void arena_destroy(arena_t *arena)
+{
+    if (arena->base != NULL)
+        mem_free_huge(arena->base, arena->capacity);
+    memset(arena, 0, sizeof(*arena));
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size_t offset = round_up(arena->used, ARENA_ALIGN);
+
+    if (offset > arena->capacity || size > arena->capacity - offset)
+        return NULL;
+
+    arena->used = offset + size;
+    if (arena->used > arena->high_water)
+        arena->high_water = arena->used;
+    arena->alloc_cnt++;
+    return arena->base + offset;
+}
+
+void *arena_calloc(arena_t *arena, size_t num, size_t size)
+{
+    void *ptr = arena_alloc(arena, num * size);
+
+    if (ptr != NULL)
+        memset(ptr, 0, num * size);
+    return ptr;
+}
+
+void arena_reset(arena_t *arena)
+{
+    arena->used = 0;
+}
+
+void *mem_alloc_huge(size_t size)
+{
+    size_t len = round_up(size, HUGE_PAGE_SIZE);
+
+    stats.alloc_cnt++;
+
+#ifdef MEM_HAVE_MMAP
+    char *ptr;
+    size_t lead;
+
+#ifdef MAP_HUGETLB
+    ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+        stats.hugetlb_bytes += len;
+        return ptr;
+    }
+#endif
+
+    // over-map by one huge page so the region can be trimmed to a 2 MB boundary
+    ptr = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    lead = round_up((uintptr_t)ptr, HUGE_PAGE_SIZE) - (uintptr_t)ptr;
+    if (lead > 0)
+        munmap(ptr, lead);
+    munmap(ptr + lead + len, HUGE_PAGE_SIZE - lead);
+    ptr += lead;
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(ptr, len, MADV_HUGEPAGE) == 0) {
+        stats.thp_bytes += len;
+        return ptr;
+    }
+#endif
+    stats.small_bytes += len;
+    return ptr;
+#else
+    stats.small_bytes += len;
+    return calloc(1, len);
+#endif
+}
+
+void mem_free_huge(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return;
+#ifdef MEM_HAVE_MMAP
+    munmap(ptr, round_up(size, HUGE_PAGE_SIZE));
+#else
+    (void)size;
+    free(ptr);
+#endif
+}
+
+void mem_get_stats(mem_stats_t *out)
+{
+    *out = stats;
+}
+
+size_t mem_thp_resident_bytes(void)
+{
+    size_t kb = 0;
+#ifdef __linux__
+    char line[256];
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+            break;
+    }
+    fclose(f);
+#endif
+    return kb * 1024;
+}
+
+#ifdef __linux__
+static int tlb_fds[MAX_TLB_COUNTERS];
+static int tlb_fd_cnt;
+
+static int tlb_counter_open_tid(pid_t tid)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.config         = PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+}
+#endif
+
+bool tlb_counters_open(void)
+{
+#ifdef __linux__
+    DIR *dir = opendir("/proc/self/task");
+    struct dirent *entry;
+
+    if (dir == NULL)
+        return false;
+    while ((entry = readdir(dir)) != NULL && tlb_fd_cnt < MAX_TLB_COUNTERS) {
+        if (entry->d_name[0] == '.')
+            continue;
+        int fd = tlb_counter_open_tid(atoi(entry->d_name));
+        if (fd >= 0)
+            tlb_fds[tlb_fd_cnt++] = fd;
+    }
+    closedir(dir);
+    return tlb_fd_cnt > 0;
+#else
+    return false;
+#endif
+}
+
+void tlb_counters_close(void)
+{
+#ifdef __linux__
+    for (int i = 0; i < tlb_fd_cnt; i++)
+        close(tlb_fds[i]);
+    tlb_fd_cnt = 0;
+#endif
+}
+
+uint64_t tlb_counters_read(void)
+{
+    uint64_t total = 0;
+#ifdef __linux__
+    for (int i = 0; i < tlb_fd_cnt; i++) {
+        uint64_t count;
+        if (read(tlb_fds[i], &count, sizeof(count)) == sizeof(count))
+            total += count;
+    }
+#endif
+    return total;
+}
@@ -0,0 +1,49 @@
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Bump allocator for scratch memory that lives for a single frame.
+// Everything is released at once by arena_reset, nothing is freed individually.
+typedef struct {
+    char   *base;
+    size_t  capacity;
+    size_t  used;
+    size_t  high_water;
+    size_t  alloc_cnt;
+} arena_t;
+
+bool arena_init(arena_t *arena, size_t capacity);
+void arena_destroy(arena_t *arena);
+
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_calloc(arena_t *arena, size_t num, size_t size);
+void arena_reset(arena_t *arena);
+
+typedef struct {
+    size_t hugetlb_bytes;  // explicit MAP_HUGETLB mappings
+    size_t thp_bytes;      // mappings madvised for transparent huge pages
+    size_t small_bytes;    // regular page fallback
+    size_t alloc_cnt;
+} mem_stats_t;
+
+// Zeroed, 2 MB aligned allocation for large hot arrays. Tries explicit huge pages,
+// then transparent huge pages, then plain pages. Free with the same size.
+void *mem_alloc_huge(size_t size);
+void mem_free_huge(void *ptr, size_t size);
+
+void mem_get_stats(mem_stats_t *stats);
+// AnonHugePages actually resident for this process, 0 where unsupported
+size_t mem_thp_resident_bytes(void);
+
+// Data TLB miss counters for every thread alive at open time (Linux perf events).
+// Open after the thread pool is created so its workers are included.
+bool tlb_counters_open(void);
+void tlb_counters_close(void);
+uint64_t tlb_counters_read(void);
+
+#endif /* __MEM_H__ */
@@ -0,0 +1,28 @@
+#ifndef __PARTICLE_H__
+#define __PARTICLE_H__
+
+#include <stdint.h>
+
+#define BIN_SIZE 0.04
+#define GRID_WIDTH (512*2)
+#define GRID_HEIGHT (512*2)
+// #define MAX_PARTICLES_PER_BIN 256
+
+typedef struct {
+    float position[2];
+    float velocity[2];
+} Particle;
+
+// Particles of a bin sit contiguously at [offset, offset + total_count) once sorted
+typedef struct {
+    uint32_t offset;
+    uint16_t total_count;
+    uint16_t cur_count;
+} Bin;
+
+static inline uint32_t position_to_bin_idx(float x, float y) {
+    return ((uint32_t) (x / BIN_SIZE + 0.5 * GRID_WIDTH)) + 
+           ((uint32_t) (y / BIN_SIZE + 0.5 * GRID_HEIGHT)) * GRID_WIDTH;
+}
+
+#endif /* __PARTICLE_H__ */
@@ -0,0 +1,220 @@
+#include "splat.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    splat_t  *splat;
+    int       start_row;
+    int       end_row;
+    Bin      *bins;
+    Particle *particles;
+} splat_work_t;
+
+static void *splat_writer(void *arg)
+{
+    splat_t *splat = arg;
+    char     path[256];
+
+    pthread_mutex_lock(&(splat->mutex));
+    while (1) {
+        while (!splat->pending && !splat->stop)
+            pthread_cond_wait(&(splat->cond), &(splat->mutex));
+        if (!splat->pending)
+            break;
+
+        // the front buffer is ours until pending is cleared
+        uint8_t *rgb = splat->rgb[1 - splat->back];
+        snprintf(path, sizeof(path), splat->path_fmt, splat->pending_idx);
+        pthread_mutex_unlock(&(splat->mutex));
+
+        FILE *f = fopen(path, "wb");
+        if (f != NULL) {
+            fprintf(f, "P6\n%d %d\n255\n", splat->width, splat->height);
+            fwrite(rgb, 3, (size_t)splat->width * splat->height, f);
+            fclose(f);
+        } else {
+            fprintf(stderr, "Failed to open %s for writing\n", path);
+        }
+
+        pthread_mutex_lock(&(splat->mutex));
+        splat->pending = false;
+        splat->written_cnt++;
+    }
+    pthread_mutex_unlock(&(splat->mutex));
+    return NULL;
+}
+
+splat_t *splat_create(int width, int height, const float *scale, float exposure, float speed_scale,
+                      const char *path_fmt)
+{
+    splat_t *splat;
+    size_t   pixels = (size_t)width * height;
+
+    splat              = calloc(1, sizeof(*splat));
+    splat->width       = width;
+    splat->height      = height;
+    splat->scale[0]    = scale[0];
+    splat->scale[1]    = scale[1];
+    splat->exposure    = exposure;
+    splat->speed_scale = speed_scale;
+    splat->path_fmt    = path_fmt;
+    splat->density     = mem_alloc_huge(pixels * sizeof(float));
+    splat->speed       = mem_alloc_huge(pixels * sizeof(float));
+    splat->rgb[0]      = mem_alloc_huge(pixels * 3);
+    splat->rgb[1]      = mem_alloc_huge(pixels * 3);
+
+    pthread_mutex_init(&(splat->mutex), NULL);
+    pthread_cond_init(&(splat->cond), NULL);
+    pthread_create(&(splat->writer), NULL, splat_writer, splat);
+
+    return splat;
+}
+
+void splat_destroy(splat_t *splat)
+{
+    size_t pixels;
+
+    if (splat == NULL)
+        return;
+
+    pthread_mutex_lock(&(splat->mutex));
+    splat->stop = true;
+    pthread_cond_broadcast(&(splat->cond));
+    pthread_mutex_unlock(&(splat->mutex));
+    pthread_join(splat->writer, NULL);
+
+    pthread_mutex_destroy(&(splat->mutex));
+    pthread_cond_destroy(&(splat->cond));
+
+    pixels = (size_t)splat->width * splat->height;
+    mem_free_huge(splat->density, pixels * sizeof(float));
+    mem_free_huge(splat->speed, pixels * sizeof(float));
+    mem_free_huge(splat->rgb[0], pixels * 3);
+    mem_free_huge(splat->rgb[1], pixels * 3);
+    free(splat);
+}
+
+// Image row of a world y coordinate, continuous, row centers at +0.5
+static float world_to_row(const splat_t *splat, float y)
+{
+    return (0.5f - 0.5f * splat->scale[1] * y) * splat->height;
+}
+
+static int row_to_bin_row(const splat_t *splat, float row)
+{
+    float y  = (0.5f - row / splat->height) * 2.0f / splat->scale[1];
+    int   by = (int)floorf(y / BIN_SIZE + 0.5f * GRID_HEIGHT);
+
+    return by < 0 ? 0 : (by >= GRID_HEIGHT ? GRID_HEIGHT - 1 : by);
+}
+
+// Each work item owns a band of image rows. Particles are sorted by bin row, so the
+// ones that can land in the band are one contiguous range, and the band's pixels stay
+// in cache while they are splatted. Tone mapping happens in the same pass.
+static void splat_rows(void *arg)
+{
+    splat_work_t *work   = arg;
+    splat_t      *splat  = work->splat;
+    int           width  = splat->width;
+    float        *density = splat->density + (size_t)work->start_row * width;
+    float        *speed   = splat->speed + (size_t)work->start_row * width;
+    size_t        band    = (size_t)(work->end_row - work->start_row) * width;
+    uint8_t      *rgb     = splat->rgb[splat->back] + (size_t)work->start_row * width * 3;
+
+    memset(density, 0, band * sizeof(float));
+    memset(speed, 0, band * sizeof(float));
+
+    // a bilinear footprint reaches one row past the band on either side, and particles may
+    // have moved up to a bin since they were sorted. Image rows grow downwards.
+    int by_lo = row_to_bin_row(splat, work->end_row + 1.0f) - 1;
+    int by_hi = row_to_bin_row(splat, work->start_row - 1.0f) + 1;
+    by_lo = by_lo < 0 ? 0 : by_lo;
+    by_hi = by_hi >= GRID_HEIGHT ? GRID_HEIGHT - 1 : by_hi;
+    Bin *last = work->bins + (by_hi + 1) * GRID_WIDTH - 1;
+    uint32_t first_idx = work->bins[by_lo * GRID_WIDTH].offset;
+    uint32_t last_idx  = last->offset + last->total_count;
+
+    for (uint32_t i = first_idx; i < last_idx; i++) {
+        Particle *p  = work->particles + i;
+        float     fx = (0.5f + 0.5f * splat->scale[0] * p->position[0]) * width - 0.5f;
+        float     fy = world_to_row(splat, p->position[1]) - 0.5f;
+        int       x0 = (int)floorf(fx);
+        int       y0 = (int)floorf(fy);
+        float     tx = fx - x0;
+        float     ty = fy - y0;
+        float     v  = sqrtf(p->velocity[0] * p->velocity[0] + p->velocity[1] * p->velocity[1]);
+
+        if (x0 < -1 || x0 >= width || y0 < work->start_row - 1 || y0 >= work->end_row)
+            continue;
+
+        for (int j = 0; j < 4; j++) {
+            int   x = x0 + (j & 1);
+            int   y = y0 + (j >> 1);
+            float w = ((j & 1) ? tx : 1.0f - tx) * ((j >> 1) ? ty : 1.0f - ty);
+            if (x < 0 || x >= width || y < work->start_row || y >= work->end_row)
+                continue;
+            size_t px = (size_t)(y - work->start_row) * width + x;
+            density[px] += w;
+            speed[px]   += w * v;
+        }
+    }
+
+    for (size_t px = 0; px < band; px++) {
+        float brightness = 1.0f - expf(-density[px] / splat->exposure);
+        float heat       = density[px] > 0.0f ? speed[px] / (density[px] * splat->speed_scale) : 0.0f;
+        heat = heat > 1.0f ? 1.0f : heat;
+
+        // cool blue for slow regions through to orange for fast ones
+        rgb[px * 3 + 0] = (uint8_t)(255.0f * brightness * (0.25f + 0.75f * heat));
+        rgb[px * 3 + 1] = (uint8_t)(255.0f * brightness * (0.45f + 0.15f * heat));
+        rgb[px * 3 + 2] = (uint8_t)(255.0f * brightness * (1.0f - 0.8f * heat));
+    }
+}
+
+bool splat_frame(splat_t *splat, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles, int frame_idx)
+{
+    int num_work_items = (int)tm->thread_cnt * 4;
+    splat_work_t *work;
+    bool busy;
+
+    pthread_mutex_lock(&(splat->mutex));
+    busy = splat->pending;
+    if (busy)
+        splat->dropped_cnt++;
+    pthread_mutex_unlock(&(splat->mutex));
+    if (busy)
+        return false;
+
+    if (num_work_items > splat->height)
+        num_work_items = splat->height;
+
+    work = arena_calloc(arena, num_work_items, sizeof(*work));
+    for (int i = 0; i < num_work_items; i++) {
+        work[i].splat     = splat;
+        work[i].start_row = splat->height * i / num_work_items;
+        work[i].end_row   = splat->height * (i + 1) / num_work_items;
+        work[i].bins      = bins;
+        work[i].particles = particles;
+        tpool_add_work(tm, splat_rows, work + i);
+    }
+    tpool_wait(tm);
+
+    pthread_mutex_lock(&(splat->mutex));
+    splat->back        = 1 - splat->back;
+    splat->pending     = true;
+    splat->pending_idx = frame_idx;
+    pthread_cond_signal(&(splat->cond));
+    pthread_mutex_unlock(&(splat->mutex));
+    return true;
+}
+
+void splat_get_counts(splat_t *splat, size_t *written_cnt, size_t *dropped_cnt)
+{
+    pthread_mutex_lock(&(splat->mutex));
+    *written_cnt = splat->written_cnt;
+    *dropped_cnt = splat->dropped_cnt;
+    pthread_mutex_unlock(&(splat->mutex));
+}
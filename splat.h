@@ -0,0 +1,53 @@
+#ifndef __SPLAT_H__
+#define __SPLAT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mem.h"
+#include "particle.h"
+#include "tpool.h"
+
+// Software density renderer for runs without a GL context. Particles are
+// bilinearly splatted into a float density and speed image, tone-mapped to
+// RGB and written as binary PPM by a background thread.
+
+typedef struct {
+    int              width;
+    int              height;
+    float            scale[2];     // world to NDC, same transform as the GL vertex shader
+    float            exposure;     // density (particles per pixel) giving ~63% brightness
+    float            speed_scale;  // mean speed mapped to the hottest color
+    const char      *path_fmt;     // printf format taking the frame index
+    float           *density;
+    float           *speed;
+    uint8_t         *rgb[2];       // rgb[back] is filled while the writer owns the other
+    int              back;
+
+    pthread_t        writer;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+    bool             pending;      // a frame is queued or being written
+    bool             stop;
+    int              pending_idx;
+
+    size_t           written_cnt;  // guarded by mutex, read with splat_get_counts
+    size_t           dropped_cnt;
+} splat_t;
+
+splat_t *splat_create(int width, int height, const float *scale, float exposure, float speed_scale,
+                      const char *path_fmt);
+// Waits for the last queued frame to be written
+void splat_destroy(splat_t *splat);
+
+// Splat and tone-map on the pool, then queue the image for writing. Never waits on
+// the writer: if the previous frame is still being written this one is dropped
+// and false is returned. Requires particles sorted by bin.
+bool splat_frame(splat_t *splat, tpool_t *tm, arena_t *arena, Bin *bins, Particle *particles, int frame_idx);
+
+// Snapshot of the written / dropped frame counters, taken under the writer lock
+void splat_get_counts(splat_t *splat, size_t *written_cnt, size_t *dropped_cnt);
+
+#endif /* __SPLAT_H__ */
@@ -2,14 +2,24 @@
 
 #include "tpool.h"
 
-static tpool_work_t *tpool_work_create(thread_func_t func, void *arg)
+// Called with work_mutex held. Reuses retired work items so that
+// steady-state dispatch does not hit malloc.
+static tpool_work_t *tpool_work_create(tpool_t *tm, thread_func_t func, void *arg)
 {
     tpool_work_t *work;
 
     if (func == NULL)
         return NULL;
 
-    work       = malloc(sizeof(*work));
+    if (tm->work_free != NULL) {
+        work          = tm->work_free;
+        tm->work_free = work->next;
+    } else {
+        work = malloc(sizeof(*work));
+        if (work == NULL)
+            return NULL;
+        tm->work_alloc_cnt++;
+    }
     work->func = func;
     work->arg  = arg;
     work->next = NULL;
@@ -23,6 +33,15 @@ static void tpool_work_destroy(tpool_work_t *work)
     free(work);
 }
 
+// Called with work_mutex held.
+static void tpool_work_release(tpool_t *tm, tpool_work_t *work)
+{
+    if (work == NULL)
+        return;
+    work->next    = tm->work_free;
+    tm->work_free = work;
+}
+
 
 
 static tpool_work_t *tpool_work_get(tpool_t *tm)
@@ -64,12 +83,11 @@ static void *tpool_worker(void *arg)
         tm->working_cnt++;
         pthread_mutex_unlock(&(tm->work_mutex));
 
-        if (work != NULL) {
+        if (work != NULL)
             work->func(work->arg);
-            tpool_work_destroy(work);
-        }
 
         pthread_mutex_lock(&(tm->work_mutex));
+        tpool_work_release(tm, work);
         tm->working_cnt--;
         if (!tm->stop && tm->working_cnt == 0 && tm->work_first == NULL)
             pthread_cond_signal(&(tm->working_cond));
@@ -131,6 +149,13 @@ void tpool_destroy(tpool_t *tm)
 
     tpool_wait(tm);
 
+    work = tm->work_free;
+    while (work != NULL) {
+        work2 = work->next;
+        tpool_work_destroy(work);
+        work = work2;
+    }
+
     pthread_mutex_destroy(&(tm->work_mutex));
     pthread_cond_destroy(&(tm->work_cond));
     pthread_cond_destroy(&(tm->working_cond));
@@ -145,11 +170,13 @@ bool tpool_add_work(tpool_t *tm, thread_func_t func, void *arg)
     if (tm == NULL)
         return false;
 
-    work = tpool_work_create(func, arg);
-    if (work == NULL)
+    pthread_mutex_lock(&(tm->work_mutex));
+    work = tpool_work_create(tm, func, arg);
+    if (work == NULL) {
+        pthread_mutex_unlock(&(tm->work_mutex));
         return false;
+    }
 
-    pthread_mutex_lock(&(tm->work_mutex));
     if (tm->work_first == NULL) {
         tm->work_first = work;
         tm->work_last  = tm->work_first;
@@ -23,6 +23,8 @@ typedef struct tpool_work tpool_work_t;
 struct tpool {
     tpool_work_t    *work_first;
     tpool_work_t    *work_last;
+    tpool_work_t    *work_free;
+    size_t           work_alloc_cnt;
     pthread_mutex_t  work_mutex;
     pthread_cond_t   work_cond;
     pthread_cond_t   working_cond;